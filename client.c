@@ -6,7 +6,7 @@
  * Single-file version - no external headers needed
  * 
  * Compile: gcc -o client client.c
- * Run: ./client <slot 0-4> <player_name>
+ * Run: ./client <slot 0-31> <player_name>
  */
 
 #include <stdio.h>
@@ -17,20 +17,36 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/select.h>
+#include <sys/ioctl.h>
 #include <signal.h>
 #include <errno.h>
 #include <time.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <poll.h>
 
 // ============================================================================
 // Configuration & Constants (from common.h)
 // ============================================================================
 
-#define MAX_PLAYERS 5
+#define MAX_PLAYERS 5           // seats per room
+#define FIFO_SLOTS 32
 #define MAX_NAME_LEN 32
 #define MAX_LOG_MSG 256
 #define GRID_SIZE 9
 #define EMPTY_CELL 0
+#define LEADERBOARD_SIZE 16
 #define PIPE_BASE "/tmp/sudoku_pipe_"
+#define SHM_KEY_VIEW 0x56494557 // "VIEW", published by ./server --shared-view
 
 // ============================================================================
 // Type Definitions (from common.h)
@@ -43,6 +59,12 @@ typedef enum {
     PLAYER_FINISHED
 } PlayerState;
 
+typedef enum {
+    GAME_WAITING_FOR_PLAYERS = 0,
+    GAME_IN_PROGRESS,
+    GAME_FINISHED
+} GameState;
+
 typedef struct {
     int id;
     char name[MAX_NAME_LEN];
@@ -55,7 +77,6 @@ typedef struct {
 
 typedef struct {
     int value;
-    int solution;
     int is_fixed;
     int placed_by;
 } SudokuCell;
@@ -73,24 +94,186 @@ typedef enum {
     MSG_PLAYER_JOINED,
     MSG_PLAYER_LEFT,
     MSG_GAME_START,
-    MSG_GRID_UPDATE
+    MSG_GRID_UPDATE,
+    MSG_LEADERBOARD,
+    MSG_STATS,
+    MSG_WATCH,
+    MSG_RESUME
 } MessageType;
 
+// ============================================================================
+// Wire Protocol (from common.h)
+// ============================================================================
+//
+// A FrameHeader followed by `length` payload bytes: a fixed body that
+// depends on the type, then optional text (not NUL-terminated). Moves and
+// turn changes arrive as deltas on top of local_grid; a gap in the move
+// sequence number makes us ask for a fresh snapshot.
+
+#define PROTO_VERSION 2
+#define NO_PLAYER 0xFF
+#define MAX_PAYLOAD 1024
+
+typedef struct {
+    uint8_t version;
+    uint8_t type;
+    uint16_t length;
+    uint32_t seq;
+} FrameHeader;
+
+typedef struct {
+    uint8_t row;
+    uint8_t col;
+    uint8_t value;
+    uint8_t placed_by;
+} CellDelta;
+
+// MSG_PLACE carries one CellDelta, or with --moves-per-turn up to
+// MAX_BATCH_MOVES of them back to back; each move played gets its own
+// MSG_PLACE_RESULT, all of them ahead of the one turn notice.
+#define MAX_BATCH_MOVES 9
+
+typedef struct {
+    CellDelta cell;             // attempted placement, placed_by = mover
+    uint8_t success;
+    uint8_t cells_remaining;
+    int8_t current_turn;
+    int8_t points;
+    int32_t score;              // mover's score after the move
+} MoveDelta;
+
+typedef struct {
+    int8_t current_turn;
+    uint8_t cells_remaining;
+} TurnDelta;
+
+typedef struct {
+    int32_t score;
+    uint16_t correct;
+    uint16_t wrong;
+    uint8_t id;
+    uint8_t state;
+    char name[MAX_NAME_LEN];
+} WirePlayer;
+
+typedef struct {
+    uint16_t room_id;
+    uint8_t game_state;
+    uint8_t num_players;
+    int8_t current_turn;
+    uint8_t cells_remaining;
+    uint8_t value[GRID_SIZE * GRID_SIZE];
+    uint8_t placed_by[GRID_SIZE * GRID_SIZE];   // NO_PLAYER for givens/empty
+    WirePlayer players[MAX_PLAYERS];
+} Snapshot;
+
+// Sent ahead of the snapshot in MSG_PLAYER_JOINED.
+typedef struct {
+    uint16_t room_id;
+    uint8_t seat;
+    uint8_t reserved;
+} SeatInfo;
+
+typedef enum {
+    DIFF_ANY = 0,               // join whatever room is waiting
+    DIFF_EASY,
+    DIFF_MEDIUM,
+    DIFF_HARD,
+    DIFF_EXPERT
+} Difficulty;
+
+typedef struct {
+    char name[MAX_NAME_LEN];
+    uint8_t difficulty;
+} JoinRequest;
+
+// A server with --journal follows a seat with a MSG_RESUME carrying its
+// uint64 token; sending it back after a restart reclaims the seat.
+
+typedef enum {
+    BOARD_WINS = 0,
+    BOARD_ACCURACY
+} BoardKind;
+
+// MSG_LEADERBOARD: we send one byte naming the board, the reply is a
+// Leaderboard, best first.
+typedef struct {
+    char name[MAX_NAME_LEN];
+    int32_t wins;
+    uint32_t correct;
+    uint32_t wrong;
+} LeaderEntry;
+
+typedef struct {
+    uint8_t board;
+    uint8_t count;
+    uint16_t reserved;
+    uint32_t total_players;
+    LeaderEntry entries[LEADERBOARD_SIZE];
+} Leaderboard;
+
+// MSG_STATS reply: server latency percentiles (ns) and health counters.
+#define STATS_STAGES 5
+
+typedef struct {
+    char name[16];
+    uint64_t count;
+    uint64_t mean_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+} StageStats;
+
+typedef struct {
+    uint32_t num_stages;
+    uint32_t rooms_in_use;
+    StageStats stages[STATS_STAGES];
+    uint64_t lock_acquired;
+    uint64_t lock_contended;
+    uint64_t lock_parked;
+    uint64_t log_dropped;
+    uint32_t send_failures;
+    uint32_t sends_queued;
+    uint32_t resyncs;
+    uint32_t evictions;
+} StatsReply;
+
+typedef struct {
+    FrameHeader hdr;
+    uint8_t payload[MAX_PAYLOAD];
+} Frame;
+
+// Read-only view of every room, kept by a server started with
+// --shared-view. seq is odd while a room is being rewritten.
+#define VIEW_MAGIC 0x57454956
+
+typedef struct {
+    volatile uint32_t seq;
+    uint32_t move_seq;
+    Snapshot snap;
+} RoomView;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t num_rooms;
+    RoomView rooms[];
+} ViewSegment;
+
+// A received frame split into its body and its text.
 typedef struct {
     MessageType type;
-    int player_id;
-    char player_name[MAX_NAME_LEN];
-    int row;
-    int col;
-    int value;
-    int success;
-    int points_earned;
+    uint32_t seq;
+    SeatInfo seat;              // MSG_PLAYER_JOINED only
+    union {
+        Snapshot snapshot;
+        MoveDelta move;
+        TurnDelta turn;
+        Leaderboard leaders;
+        StatsReply stats;
+        uint64_t token;         // MSG_RESUME
+    } body;
     char text[MAX_LOG_MSG];
-    SudokuCell grid[GRID_SIZE][GRID_SIZE];
-    int cells_remaining;
-    Player players[MAX_PLAYERS];
-    int num_players;
-    int current_turn;
 } GameMessage;
 
 // ============================================================================
@@ -100,6 +283,11 @@ typedef struct {
 int pipe_write_fd = -1;
 int pipe_read_fd = -1;
 int player_slot = -1;
+int my_seat = -1;               // our seat in the room, assigned on join
+int my_room = -1;
+int watching = 0;               // spectating my_room, no seat
+int watch_from_room = -1;       // where we were if the server refuses the watch
+int watch_from_seat = -1;
 char my_name[MAX_NAME_LEN] = "";
 
 SudokuCell local_grid[GRID_SIZE][GRID_SIZE];
@@ -107,8 +295,17 @@ Player local_players[MAX_PLAYERS];
 int local_cells_remaining = 0;
 int local_num_players = 0;
 int local_current_turn = -1;
+int local_game_state = GAME_WAITING_FOR_PLAYERS;
+uint32_t local_seq = 0;
+int need_resync = 0;
+int server_gone = 0;            // the connection closed or broke
+const char *server_address = NULL;
+uint64_t resume_token = 0;      // our seat's, if the server journals games
+int resuming = 0;               // a MSG_RESUME is waiting for its answer
+const ViewSegment *room_view = NULL;  // attached if the server publishes one
 
 volatile sig_atomic_t client_running = 1;
+volatile sig_atomic_t term_resized = 0;
 
 // ============================================================================
 // Signal Handler
@@ -120,6 +317,11 @@ void sigint_handler(int sig) {
     printf("\n[Client] Shutting down...\n");
 }
 
+void sigwinch_handler(int sig) {
+    (void)sig;
+    term_resized = 1;
+}
+
 // ============================================================================
 // Display Functions
 // ============================================================================
@@ -128,9 +330,18 @@ void print_help(void) {
     printf("\n=== COMMANDS ===\n");
     printf("  place R C N  - Place number N at row R, column C\n");
     printf("               - Example: 'place 3 5 7' puts 7 at row 3, col 5\n");
+    printf("               - More R C N triples play several moves in one turn\n");
+    printf("               - (on a server started with --moves-per-turn)\n");
     printf("  p R C N      - Short form of place\n");
     printf("  status       - View current game state and scores\n");
     printf("  grid         - Display the Sudoku grid\n");
+    printf("  join [LEVEL] - Queue for a new game (e.g. after one ends)\n");
+    printf("               - LEVEL: easy, medium, hard, expert or any\n");
+    printf("  top [BOARD]  - Show the all-time leaderboard\n");
+    printf("               - BOARD: wins (default) or accuracy\n");
+    printf("  hint [R C]   - Show which numbers fit a cell (or the tightest cell)\n");
+    printf("  stats        - Show server latency and health counters\n");
+    printf("  watch ROOM   - Leave your seat and follow a room as a spectator\n");
     printf("  help         - Show this help message\n");
     printf("  quit         - Leave the game\n");
     printf("================\n\n");
@@ -149,7 +360,7 @@ void print_game_rules(void) {
     printf("|  * Use: place <row> <col> <number>                        |\n");
     printf("|  * Example: 'place 3 5 7' puts 7 at row 3, column 5       |\n");
     printf("|                                                           |\n");
-    printf("|  SCORING:                                                 |\n");
+    printf("|  SCORING (server defaults, the server may change them):   |\n");
     printf("|  * Correct placement: +10 points                          |\n");
     printf("|  * Wrong placement:   -5 points (cell stays empty)        |\n");
     printf("|                                                           |\n");
@@ -162,83 +373,464 @@ void print_game_rules(void) {
     printf("|  * (X) = Placed by a player                               |\n");
     printf("|  *  .  = Empty cell                                       |\n");
     printf("|                                                           |\n");
-    printf("|  Players: 3-5 | Turn Order: Round Robin                   |\n");
+    printf("|  Players: 3-5 by default | Turn Order: Round Robin        |\n");
     printf("+-----------------------------------------------------------+\n\n");
 }
 
-void print_grid(void) {
-    printf("\n");
-    printf("    +-------+-------+-------+\n");
-    printf("      1 2 3   4 5 6   7 8 9\n");
-    printf("    +-------+-------+-------+\n");
+int read_view(void);
+
+void print_leaderboard(const Leaderboard *board) {
+    int count = board->count < LEADERBOARD_SIZE ? board->count : LEADERBOARD_SIZE;
+    
+    printf("\n=== LEADERBOARD (%s) ===\n",
+           board->board == BOARD_ACCURACY ? "accuracy" : "wins");
+    if (count == 0) {
+        printf("  No ranked players yet\n");
+    }
+    for (int i = 0; i < count; i++) {
+        const LeaderEntry *e = &board->entries[i];
+        uint32_t moves = e->correct + e->wrong;
+        printf("  %2d. %-12.*s | Wins: %4d | Correct: %5u | Wrong: %4u | %5.1f%%\n",
+               i + 1, MAX_NAME_LEN, e->name, e->wins, e->correct, e->wrong,
+               moves ? 100.0 * e->correct / moves : 0.0);
+    }
+    printf("  (%u players recorded)\n", board->total_players);
+    printf("========================\n");
+}
+
+void print_stats(const StatsReply *stats) {
+    uint32_t n = stats->num_stages < STATS_STAGES ? stats->num_stages : STATS_STAGES;
+    
+    printf("\n=== SERVER STATS (%u rooms in use) ===\n", stats->rooms_in_use);
+    printf("  %-12s %9s %9s %9s %9s %9s\n", "stage (us)", "count", "p50", "p90", "p99", "max");
+    for (uint32_t i = 0; i < n; i++) {
+        const StageStats *s = &stats->stages[i];
+        printf("  %-12.16s %9llu %9.1f %9.1f %9.1f %9.1f\n", s->name,
+               (unsigned long long)s->count, s->p50_ns / 1000.0, s->p90_ns / 1000.0,
+               s->p99_ns / 1000.0, s->max_ns / 1000.0);
+    }
+    printf("  Locks: %llu taken, %llu contended, %llu parked\n",
+           (unsigned long long)stats->lock_acquired, (unsigned long long)stats->lock_contended,
+           (unsigned long long)stats->lock_parked);
+    printf("  Sends: %u queued, %u failed, %u resyncs, %u evictions | Log drops: %llu\n",
+           stats->sends_queued, stats->send_failures, stats->resyncs, stats->evictions,
+           (unsigned long long)stats->log_dropped);
+    printf("=====================================\n");
+}
+
+// ============================================================================
+// Renderer
+// ============================================================================
+//
+// The board and scoreboard are composed as BOARD_LINES lines and sent with
+// a single write(). On a terminal that takes ANSI escapes they stay in a
+// fixed region at the top of the screen while messages scroll underneath,
+// and a redraw only rewrites the characters that changed since the last
+// one. Anywhere else (pipes, logs, TERM=dumb, tiny windows) the whole board
+// is printed, and only when it differs from what was printed last.
+
+#define BOARD_LINES 26
+#define BOARD_COLS 128
+#define SEAT_LINE0 (BOARD_LINES - 1 - MAX_PLAYERS)     // first scoreboard seat
+#define RENDER_BUF_BYTES 16384
+
+typedef struct {
+    size_t len;
+    char data[RENDER_BUF_BYTES];
+} OutBuf;
+
+static OutBuf render_out;
+static char shown[BOARD_LINES][BOARD_COLS];     // what the screen holds now
+static int shown_valid = 0;
+static int ansi_mode = 0;
+static int term_rows = 0;
+static int term_cols = 0;
+
+static void out_printf(OutBuf *out, const char *format, ...) {
+    if (out->len >= RENDER_BUF_BYTES) return;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(out->data + out->len, RENDER_BUF_BYTES - out->len, format, args);
+    va_end(args);
+    if (n > 0) out->len += (size_t)n;
+    if (out->len > RENDER_BUF_BYTES) out->len = RENDER_BUF_BYTES;
+}
+
+static void out_flush(OutBuf *out) {
+    // Anything printf() still holds belongs above the board.
+    fflush(stdout);
+    const char *p = out->data;
+    size_t left = out->len;
+    while (left > 0) {
+        ssize_t n = write(STDOUT_FILENO, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        left -= (size_t)n;
+    }
+    out->len = 0;
+}
+
+static void compose_board(char lines[BOARD_LINES][BOARD_COLS]) {
+    static const char *rule = "    +-------+-------+-------+";
+    int n = 0;
+    
+    memset(lines, 0, BOARD_LINES * BOARD_COLS);
+    snprintf(lines[n++], BOARD_COLS, "%s", rule);
+    snprintf(lines[n++], BOARD_COLS, "      1 2 3   4 5 6   7 8 9");
+    snprintf(lines[n++], BOARD_COLS, "%s", rule);
     
     for (int r = 0; r < GRID_SIZE; r++) {
-        if (r > 0 && r % 3 == 0) {
-            printf("    +-------+-------+-------+\n");
-        }
-        
-        printf(" %d  |", r + 1);
+        if (r > 0 && r % 3 == 0) snprintf(lines[n++], BOARD_COLS, "%s", rule);
         
+        char *line = lines[n++];
+        int len = snprintf(line, BOARD_COLS, " %d  |", r + 1);
         for (int c = 0; c < GRID_SIZE; c++) {
-            if (c > 0 && c % 3 == 0) {
-                printf("|");
-            }
-            
-            SudokuCell *cell = &local_grid[r][c];
+            if (c > 0 && c % 3 == 0) line[len++] = '|';
             
+            const SudokuCell *cell = &local_grid[r][c];
             if (cell->value == EMPTY_CELL) {
-                printf(" .");
-            } else if (cell->is_fixed) {
-                printf(" %d", cell->value);
-            } else {
-                if (cell->placed_by == player_slot) {
-                    printf("*%d", cell->value);
-                } else {
-                    printf("+%d", cell->value);
-                }
+                line[len++] = ' ';
+                line[len++] = '.';
+                continue;
             }
+            line[len++] = cell->is_fixed ? ' ' : (cell->placed_by == my_seat) ? '*' : '+';
+            line[len++] = (char)('0' + cell->value);
         }
-        printf("|\n");
+        line[len++] = '|';
     }
     
-    printf("    +-------+-------+-------+\n");
-    printf("\n  Legend: N=fixed  *N=yours  +N=other player\n");
-    printf("  Cells remaining: %d\n\n", local_cells_remaining);
+    snprintf(lines[n++], BOARD_COLS, "%s", rule);
+    n++;
+    snprintf(lines[n++], BOARD_COLS, "  Legend: N=fixed  *N=yours  +N=other player");
+    snprintf(lines[n++], BOARD_COLS, "  Room: %d | Cells remaining: %d", my_room, local_cells_remaining);
+    n++;
+    snprintf(lines[n++], BOARD_COLS, "=== SCOREBOARD ===");
+    for (int i = 0; i < MAX_PLAYERS; i++, n++) {
+        const Player *p = &local_players[i];
+        if (p->state == PLAYER_DISCONNECTED) continue;
+        snprintf(lines[n], BOARD_COLS,
+                 "  Player %d: %-12s | Score: %4d | Correct: %2d | Wrong: %2d %s",
+                 i + 1, p->name, p->score, p->correct_placements, p->wrong_placements,
+                 (local_current_turn == i) ? " <-- TURN" : "");
+    }
+    snprintf(lines[n++], BOARD_COLS, "==================");
 }
 
-void print_scoreboard(void) {
-    printf("\n=== SCOREBOARD ===\n");
-    for (int i = 0; i < MAX_PLAYERS; i++) {
-        if (local_players[i].state != PLAYER_DISCONNECTED) {
-            printf("  Player %d: %-12s | Score: %4d | Correct: %2d | Wrong: %2d %s\n",
-                   i + 1,
-                   local_players[i].name,
-                   local_players[i].score,
-                   local_players[i].correct_placements,
-                   local_players[i].wrong_placements,
-                   (local_current_turn == i) ? " <-- TURN" : "");
+static void render_plain(char lines[BOARD_LINES][BOARD_COLS], int force) {
+    if (!force && shown_valid && memcmp(lines, shown, sizeof(shown)) == 0) return;
+    
+    out_printf(&render_out, "\n");
+    for (int i = 0; i < BOARD_LINES; i++) {
+        // Empty seats have no scoreboard line.
+        if (i >= SEAT_LINE0 && i < SEAT_LINE0 + MAX_PLAYERS && lines[i][0] == '\0') continue;
+        out_printf(&render_out, "%s\n", lines[i]);
+    }
+    out_flush(&render_out);
+    memcpy(shown, lines, sizeof(shown));
+    shown_valid = 1;
+}
+
+// Append the runs of characters that differ from the screen; 0 if none.
+static int render_diff(char lines[BOARD_LINES][BOARD_COLS]) {
+    int width = (term_cols - 1 < BOARD_COLS - 1) ? term_cols - 1 : BOARD_COLS - 1;
+    int changed = 0;
+    
+    for (int i = 0; i < BOARD_LINES; i++) {
+        char *now = lines[i], *was = shown[i];
+        int now_len = (int)strnlen(now, width), was_len = (int)strnlen(was, width);
+        
+        for (int c = 0; c < now_len; ) {
+            if (c < was_len && now[c] == was[c]) {
+                c++;
+                continue;
+            }
+            int end = c;
+            while (end < now_len && (end >= was_len || now[end] != was[end])) end++;
+            out_printf(&render_out, "\033[%d;%dH%.*s", i + 1, c + 1, end - c, now + c);
+            changed++;
+            c = end;
+        }
+        if (now_len < was_len) {
+            out_printf(&render_out, "\033[%d;%dH\033[K", i + 1, now_len + 1);
+            changed++;
+        }
+    }
+    memcpy(shown, lines, sizeof(shown));
+    return changed;
+}
+
+// Clear the screen, paint the whole board and scroll only the lines below it.
+static void render_full(char lines[BOARD_LINES][BOARD_COLS]) {
+    memset(shown, 0, sizeof(shown));
+    shown_valid = 1;
+    out_printf(&render_out, "\033[r\033[2J");
+    render_diff(lines);
+    out_printf(&render_out, "\033[%d;%dr\033[%d;1H", BOARD_LINES + 2, term_rows, term_rows);
+    out_flush(&render_out);
+}
+
+// Pick the mode for the terminal we are on (again after SIGWINCH);
+// returns 1 if the board gets its own region.
+int render_init(void) {
+    struct winsize ws;
+    const char *term = getenv("TERM");
+    
+    ansi_mode = 0;
+    shown_valid = 0;
+    if (!isatty(STDOUT_FILENO) || !term || strcmp(term, "dumb") == 0) return 0;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0) return 0;
+    term_rows = ws.ws_row;
+    term_cols = ws.ws_col;
+    ansi_mode = (term_rows >= BOARD_LINES + 6 && term_cols >= 60);
+    return ansi_mode;
+}
+
+// Give the terminal its whole screen back.
+void render_reset(void) {
+    if (!ansi_mode || !shown_valid) return;
+    out_printf(&render_out, "\033[r\033[%d;1H", term_rows);
+    out_flush(&render_out);
+}
+
+// Called after anything that may have changed the game; force redraws
+// even an unchanged board (the "grid" command, a resized window).
+void render_board(int force) {
+    char lines[BOARD_LINES][BOARD_COLS];
+    
+    // Draw the newest state when the server publishes it; otherwise what
+    // the messages have told us is all we have.
+    read_view();
+    compose_board(lines);
+    
+    if (!ansi_mode) {
+        render_plain(lines, force);
+    } else if (!shown_valid || force) {
+        render_full(lines);
+    } else {
+        out_printf(&render_out, "\0337");       // the prompt's cursor
+        if (render_diff(lines)) {
+            out_printf(&render_out, "\0338");
+            out_flush(&render_out);
+        } else {
+            render_out.len = 0;
         }
     }
-    printf("==================\n");
+}
+
+// ============================================================================
+// Local Validation
+// ============================================================================
+//
+// Row, column and box digit masks kept alongside local_grid (rebuilt from
+// every snapshot, patched by every accepted move), so moves that can't
+// possibly count are refused here instead of costing a round trip. The
+// server still judges every move it does receive.
+
+#define ALL_DIGITS 0x1FF
+
+uint16_t row_used[GRID_SIZE];
+uint16_t col_used[GRID_SIZE];
+uint16_t box_used[GRID_SIZE];
+
+static inline int box_of(int row, int col) {
+    return (row / 3) * 3 + col / 3;
+}
+
+void candidates_place(int row, int col, int value) {
+    uint16_t bit = (uint16_t)(1u << (value - 1));
+    row_used[row] |= bit;
+    col_used[col] |= bit;
+    box_used[box_of(row, col)] |= bit;
+}
+
+void candidates_rebuild(void) {
+    memset(row_used, 0, sizeof(row_used));
+    memset(col_used, 0, sizeof(col_used));
+    memset(box_used, 0, sizeof(box_used));
+    for (int r = 0; r < GRID_SIZE; r++) {
+        for (int c = 0; c < GRID_SIZE; c++) {
+            int v = local_grid[r][c].value;
+            if (v >= 1 && v <= GRID_SIZE) candidates_place(r, c, v);
+        }
+    }
+}
+
+static inline uint16_t candidates_at(int row, int col) {
+    if (local_grid[row][col].value != EMPTY_CELL) return 0;
+    return ALL_DIGITS & ~(row_used[row] | col_used[col] | box_used[box_of(row, col)]);
+}
+
+// Why the move can't be accepted, or NULL to send it.
+const char *check_place(int row, int col, int value) {
+    uint16_t bit = (uint16_t)(1u << (value - 1));
+    
+    if (watching) return "Spectators can only watch";
+    if (my_seat < 0) return "You are not in a game - join one first";
+    if (local_game_state != GAME_IN_PROGRESS) return "The game has not started yet";
+    if (local_current_turn != my_seat) return "It's not your turn";
+    if (local_grid[row][col].is_fixed) return "That cell is part of the puzzle";
+    if (local_grid[row][col].value != EMPTY_CELL) return "That cell is already filled";
+    if (row_used[row] & bit) return "That number is already in that row";
+    if (col_used[col] & bit) return "That number is already in that column";
+    if (box_used[box_of(row, col)] & bit) return "That number is already in that box";
+    return NULL;
+}
+
+static void print_digits(uint16_t mask) {
+    for (int v = 1; v <= GRID_SIZE; v++) {
+        if (mask & (1u << (v - 1))) printf(" %d", v);
+    }
+}
+
+// "hint R C" lists what may go in a cell; plain "hint" points at the
+// empty cell with the fewest options. Only the local masks are consulted,
+// so a candidate can still be wrong.
+void print_hint(int row, int col) {
+    if (row < 0) {
+        int best = GRID_SIZE + 1;
+        for (int r = 0; r < GRID_SIZE; r++) {
+            for (int c = 0; c < GRID_SIZE; c++) {
+                if (local_grid[r][c].value != EMPTY_CELL) continue;
+                int n = __builtin_popcount(candidates_at(r, c));
+                if (n < best) {
+                    best = n;
+                    row = r;
+                    col = c;
+                }
+            }
+        }
+        if (row < 0) {
+            printf("\n[HINT] No empty cells left\n");
+            return;
+        }
+    }
+    
+    if (local_grid[row][col].value != EMPTY_CELL) {
+        printf("\n[HINT] (%d,%d) is already filled\n", row + 1, col + 1);
+        return;
+    }
+    uint16_t mask = candidates_at(row, col);
+    if (mask == 0) {
+        printf("\n[HINT] Nothing fits at (%d,%d) - a placed number must be wrong\n",
+               row + 1, col + 1);
+    } else if (__builtin_popcount(mask) == 1) {
+        printf("\n[HINT] Only %d fits at (%d,%d)\n", __builtin_ctz(mask) + 1, row + 1, col + 1);
+    } else {
+        printf("\n[HINT] (%d,%d) could be", row + 1, col + 1);
+        print_digits(mask);
+        printf("\n");
+    }
 }
 
 // ============================================================================
 // Network Functions
 // ============================================================================
 
-int connect_to_server(int slot) {
+static int connect_unix(const char *path) {
+    struct sockaddr_un addr;
+    
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Unix socket path too long\n");
+        return -1;
+    }
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Failed to connect to server (unix)");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int connect_tcp(const char *spec) {
+    // spec is "HOST:PORT"
+    char host[64];
+    const char *colon = strrchr(spec, ':');
+    if (!colon || (size_t)(colon - spec) >= sizeof(host)) {
+        printf("TCP address must be tcp:HOST:PORT\n");
+        return -1;
+    }
+    memcpy(host, spec, colon - spec);
+    host[colon - spec] = '\0';
+    
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    int rc = getaddrinfo(host, colon + 1, &hints, &res);
+    if (rc != 0) {
+        printf("Cannot resolve %s: %s\n", spec, gai_strerror(rc));
+        return -1;
+    }
+    
+    int fd = -1;
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    
+    if (fd < 0) {
+        perror("Failed to connect to server (tcp)");
+        return -1;
+    }
+    
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// address is a FIFO slot number, "unix:PATH" or "tcp:HOST:PORT".
+int connect_to_server(const char *address) {
+    if (strncmp(address, "unix:", 5) == 0 || strncmp(address, "tcp:", 4) == 0) {
+        printf("[Client] Connecting to server at %s...\n", address);
+        int fd = (address[0] == 'u') ? connect_unix(address + 5) : connect_tcp(address + 4);
+        if (fd < 0) return -1;
+        
+        // One socket carries both directions.
+        pipe_read_fd = fd;
+        pipe_write_fd = fd;
+        printf("[Client] Connected!\n");
+        return 0;
+    }
+    
+    int slot = atoi(address);
+    if (slot < 0 || slot >= FIFO_SLOTS) {
+        printf("Invalid slot. Must be 0-%d\n", FIFO_SLOTS - 1);
+        return -1;
+    }
+    player_slot = slot;
+    
     char pipe_to_server[64], pipe_to_client[64];
     
     snprintf(pipe_to_server, sizeof(pipe_to_server), "%s%d_to_server", PIPE_BASE, slot);
     snprintf(pipe_to_client, sizeof(pipe_to_client), "%s%d_to_client", PIPE_BASE, slot);
     
-    printf("[Client] Connecting to server on slot %d...\n", slot + 1);
+    printf("[Client] Connecting to server on slot %d...\n", slot);
     
-    pipe_write_fd = open(pipe_to_server, O_WRONLY);
+    // Reconnecting, don't wait on a FIFO nobody serves: a dead server's
+    // are replaced by the one that comes back.
+    pipe_write_fd = open(pipe_to_server, O_WRONLY | (server_gone ? O_NONBLOCK : 0));
     if (pipe_write_fd < 0) {
-        perror("Failed to connect to server (write pipe)");
+        if (!server_gone) perror("Failed to connect to server (write pipe)");
         return -1;
     }
+    if (server_gone) fcntl(pipe_write_fd, F_SETFL, 0);
     
     pipe_read_fd = open(pipe_to_client, O_RDONLY);
     if (pipe_read_fd < 0) {
@@ -251,24 +843,302 @@ int connect_to_server(int slot) {
     return 0;
 }
 
-void send_message(GameMessage *msg) {
-    write(pipe_write_fd, msg, sizeof(GameMessage));
+void send_message(MessageType type, const void *body, size_t len) {
+    Frame f;
+    f.hdr.version = PROTO_VERSION;
+    f.hdr.type = (uint8_t)type;
+    f.hdr.length = (uint16_t)len;
+    f.hdr.seq = local_seq;
+    if (len > 0) memcpy(f.payload, body, len);
+    
+    // A socket may take only part of the frame.
+    const uint8_t *p = (const uint8_t *)&f;
+    size_t left = sizeof(FrameHeader) + len;
+    while (left > 0) {
+        ssize_t n = write(pipe_write_fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            server_gone = 1;
+            return;
+        }
+        p += n;
+        left -= n;
+    }
+}
+
+// Follow a room as a spectator. The server leaves us nothing to say on
+// the connection afterwards: the feed arrives unasked and is never gappy.
+void start_watch(int room) {
+    uint16_t id = (uint16_t)room;
+    watch_from_room = my_room;
+    watch_from_seat = my_seat;
+    watching = 1;
+    my_room = room;
+    my_seat = -1;
+    local_seq = 0;
+    resume_token = 0;
+    send_message(MSG_WATCH, &id, sizeof(id));
+}
+
+// Ask for the seat the token belongs to.
+void send_resume(uint64_t token) {
+    resuming = 1;
+    local_seq = 0;
+    send_message(MSG_RESUME, &token, sizeof(token));
+}
+
+// Server output is read in bulk and cut into frames here: a frame may
+// arrive in pieces and one read may carry several, so whatever is left
+// over waits in the buffer for the next receive_message.
+#define READ_BUF_BYTES 4096
+
+typedef struct {
+    uint32_t start;             // unconsumed bytes are buf[start .. end)
+    uint32_t end;
+    uint8_t buf[READ_BUF_BYTES];
+} FrameReader;
+
+FrameReader reader;
+
+static ssize_t reader_fill(FrameReader *r, int fd) {
+    if (r->start > 0) {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    
+    ssize_t n;
+    do {
+        n = read(fd, r->buf + r->end, READ_BUF_BYTES - r->end);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) r->end += n;
+    return n;
+}
+
+// 1 if f was filled, 0 if more bytes are needed, -1 on a broken stream.
+static int reader_next(FrameReader *r, Frame *f) {
+    uint32_t avail = r->end - r->start;
+    if (avail < sizeof(FrameHeader)) return 0;
+    
+    memcpy(&f->hdr, r->buf + r->start, sizeof(FrameHeader));
+    if (f->hdr.length > MAX_PAYLOAD) return -1;
+    if (avail < sizeof(FrameHeader) + f->hdr.length) return 0;
+    
+    memcpy(f->payload, r->buf + r->start + sizeof(FrameHeader), f->hdr.length);
+    r->start += sizeof(FrameHeader) + f->hdr.length;
+    return 1;
+}
+
+// A whole frame is already buffered, so select() won't announce it.
+int frame_pending(void) {
+    uint32_t avail = reader.end - reader.start;
+    if (avail < sizeof(FrameHeader)) return 0;
+    const FrameHeader *hdr = (const FrameHeader *)(reader.buf + reader.start);
+    return avail >= sizeof(FrameHeader) + hdr->length;
+}
+
+static size_t body_size(MessageType type) {
+    switch (type) {
+        case MSG_PLAYER_JOINED:
+        case MSG_GAME_START:
+        case MSG_GAME_STATE:
+        case MSG_GAME_OVER:
+            return sizeof(Snapshot);
+        case MSG_PLACE_RESULT:
+        case MSG_GRID_UPDATE:
+            return sizeof(MoveDelta);
+        case MSG_YOUR_TURN:
+        case MSG_WAIT:
+            return sizeof(TurnDelta);
+        case MSG_LEADERBOARD:
+            return sizeof(Leaderboard);
+        case MSG_STATS:
+            return sizeof(StatsReply);
+        case MSG_RESUME:
+            return sizeof(uint64_t);
+        default:
+            return 0;
+    }
 }
 
 int receive_message(GameMessage *msg) {
-    // Blocking read from the server -> client pipe.
-    // We call this only when select() says data is ready.
-    ssize_t bytes = read(pipe_read_fd, msg, sizeof(GameMessage));
-    return (bytes > 0) ? 0 : -1;
+    // Next frame from the server, reading (blocking) only when none is
+    // buffered yet. -1 means this frame is unusable; server_gone is set
+    // once the connection itself is lost.
+    Frame f;
+    int got;
+    while ((got = reader_next(&reader, &f)) == 0) {
+        if (reader_fill(&reader, pipe_read_fd) <= 0) {
+            server_gone = 1;
+            return -1;
+        }
+    }
+    if (got < 0) {
+        server_gone = 1;
+        return -1;
+    }
+    if (f.hdr.version != PROTO_VERSION) return -1;
+    
+    msg->type = (MessageType)f.hdr.type;
+    msg->seq = f.hdr.seq;
+    
+    size_t offset = 0;
+    if (msg->type == MSG_PLAYER_JOINED) {
+        if (f.hdr.length < sizeof(SeatInfo)) return -1;
+        memcpy(&msg->seat, f.payload, sizeof(SeatInfo));
+        offset = sizeof(SeatInfo);
+    }
+    
+    size_t body = offset + body_size(msg->type);
+    if (body > f.hdr.length) return -1;
+    memcpy(&msg->body, f.payload + offset, body - offset);
+    
+    size_t text_len = f.hdr.length - body;
+    if (text_len >= MAX_LOG_MSG) text_len = MAX_LOG_MSG - 1;
+    memcpy(msg->text, f.payload + body, text_len);
+    msg->text[text_len] = '\0';
+    return 0;
+}
+
+void apply_snapshot(const Snapshot *snap, uint32_t seq) {
+    for (int r = 0; r < GRID_SIZE; r++) {
+        for (int c = 0; c < GRID_SIZE; c++) {
+            SudokuCell *cell = &local_grid[r][c];
+            int placed_by = snap->placed_by[r * GRID_SIZE + c];
+            cell->value = snap->value[r * GRID_SIZE + c];
+            cell->placed_by = (placed_by == NO_PLAYER) ? -1 : placed_by;
+            cell->is_fixed = (cell->value != EMPTY_CELL && placed_by == NO_PLAYER);
+        }
+    }
+    
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        const WirePlayer *w = &snap->players[i];
+        local_players[i].id = w->id;
+        local_players[i].score = w->score;
+        local_players[i].correct_placements = w->correct;
+        local_players[i].wrong_placements = w->wrong;
+        local_players[i].state = (PlayerState)w->state;
+        memcpy(local_players[i].name, w->name, MAX_NAME_LEN);
+        local_players[i].name[MAX_NAME_LEN - 1] = '\0';
+    }
+    
+    local_cells_remaining = snap->cells_remaining;
+    local_num_players = snap->num_players;
+    local_current_turn = snap->current_turn;
+    local_game_state = snap->game_state;
+    local_seq = seq;
+    need_resync = 0;
+    candidates_rebuild();
+}
+
+void apply_move(const MoveDelta *move, uint32_t seq) {
+    // Deltas are numbered; anything other than the next one means we
+    // missed an update, so apply what we can and ask for a snapshot.
+    if (seq <= local_seq) return;
+    if (seq != local_seq + 1) need_resync = 1;
+    
+    int mover = move->cell.placed_by;
+    if (move->success) {
+        SudokuCell *cell = &local_grid[move->cell.row][move->cell.col];
+        cell->value = move->cell.value;
+        cell->placed_by = mover;
+        cell->is_fixed = 0;
+        candidates_place(move->cell.row, move->cell.col, move->cell.value);
+    }
+    if (mover < MAX_PLAYERS) {
+        local_players[mover].score = move->score;
+        if (move->success) {
+            local_players[mover].correct_placements++;
+        } else {
+            local_players[mover].wrong_placements++;
+        }
+    }
+    
+    local_cells_remaining = move->cells_remaining;
+    local_current_turn = move->current_turn;
+    local_seq = seq;
 }
 
 void update_local_state(GameMessage *msg) {
     // Keep a local copy so the client can print without asking the server again.
-    memcpy(local_grid, msg->grid, sizeof(local_grid));
-    memcpy(local_players, msg->players, sizeof(local_players));
-    local_cells_remaining = msg->cells_remaining;
-    local_num_players = msg->num_players;
-    local_current_turn = msg->current_turn;
+    switch (msg->type) {
+        case MSG_PLAYER_JOINED:
+            my_seat = msg->seat.seat;
+            my_room = msg->seat.room_id;
+            apply_snapshot(&msg->body.snapshot, msg->seq);
+            break;
+        case MSG_GAME_START:
+        case MSG_GAME_STATE:
+        case MSG_GAME_OVER:
+            apply_snapshot(&msg->body.snapshot, msg->seq);
+            break;
+        case MSG_PLACE_RESULT:
+        case MSG_GRID_UPDATE:
+            apply_move(&msg->body.move, msg->seq);
+            break;
+        case MSG_YOUR_TURN:
+        case MSG_WAIT:
+            local_current_turn = msg->body.turn.current_turn;
+            local_cells_remaining = msg->body.turn.cells_remaining;
+            break;
+        default:
+            break;
+    }
+}
+
+// ============================================================================
+// Shared View
+// ============================================================================
+//
+// On the same host the server may publish each room in shared memory, so
+// redraws and resyncs read it directly instead of asking over the pipe.
+
+void attach_view(void) {
+    int id = shmget(SHM_KEY_VIEW, 0, 0);
+    if (id < 0) return;
+    
+    void *addr = shmat(id, NULL, SHM_RDONLY);
+    if (addr == (void *)-1) return;
+    
+    room_view = (const ViewSegment *)addr;
+    if (room_view->magic != VIEW_MAGIC) {
+        shmdt(addr);
+        room_view = NULL;
+        return;
+    }
+    printf("[Client] Reading game state from the server's shared view\n");
+}
+
+// Seqlock read of our room. Returns 0 and updates the local state if the
+// view holds our game and is at least as new as what we have.
+int read_view(void) {
+    RoomView copy;
+    RoomView *v;
+    int tries;
+    
+    if (!room_view || my_room < 0 || (uint32_t)my_room >= room_view->num_rooms) return -1;
+    if (!watching && (my_seat < 0 || my_seat >= MAX_PLAYERS)) return -1;
+    v = (RoomView *)&room_view->rooms[my_room];
+    
+    for (tries = 0; tries < 1000; tries++) {
+        uint32_t seq = v->seq;
+        if (seq & 1) continue;
+        __sync_synchronize();
+        copy.move_seq = v->move_seq;
+        memcpy(&copy.snap, &v->snap, sizeof(copy.snap));
+        __sync_synchronize();
+        if (v->seq == seq) break;
+    }
+    if (tries == 1000) return -1;
+    
+    // The room may have been recycled for someone else's game.
+    if (copy.snap.room_id != my_room) return -1;
+    if (!watching &&
+        strncmp(copy.snap.players[my_seat].name, my_name, MAX_NAME_LEN) != 0) return -1;
+    if (copy.move_seq < local_seq) return -1;
+    
+    apply_snapshot(&copy.snap, copy.move_seq);
+    return 0;
 }
 
 // ============================================================================
@@ -277,23 +1147,24 @@ void update_local_state(GameMessage *msg) {
 
 void handle_response(GameMessage *response) {
     // IMPORTANT:
-    // Most server messages include a fresh copy of the game state.
+    // Most server messages carry a snapshot or a delta of the game state.
     // Updating local state first ensures the grid/scoreboard prints correctly.
-    if (response->type == MSG_PLAYER_JOINED || 
-        response->type == MSG_GAME_START ||
-        response->type == MSG_PLACE_RESULT ||
-        response->type == MSG_GAME_STATE ||
-        response->type == MSG_GRID_UPDATE ||
-        response->type == MSG_GAME_OVER ||
-        response->type == MSG_WAIT) {
-        update_local_state(response);
-    }
+    update_local_state(response);
     
     switch (response->type) {
         case MSG_PLAYER_JOINED:
+            resuming = 0;
             printf("\n[OK] %s\n", response->text);
             break;
             
+        case MSG_RESUME:
+            if (response->body.token != resume_token) {
+                resume_token = response->body.token;
+                printf("[Client] Resume token %016llx (--resume after a server restart)\n",
+                       (unsigned long long)resume_token);
+            }
+            break;
+            
         case MSG_GAME_START:
             printf("\n");
             printf("+========================================+\n");
@@ -301,9 +1172,8 @@ void handle_response(GameMessage *response) {
             printf("+========================================+\n");
             printf("  %s\n", response->text);
             printf("+========================================+\n");
-            print_grid();
-            print_scoreboard();
-            if (local_current_turn == player_slot) {
+            render_board(0);
+            if (my_seat >= 0 && local_current_turn == my_seat) {
                 printf("\n>>> IT'S YOUR TURN! Use 'place R C N' to place a number.\n");
             }
             break;
@@ -315,47 +1185,55 @@ void handle_response(GameMessage *response) {
             if (strlen(response->text) > 0) {
                 printf("  %s\n", response->text);
             } else {
-                printf("  >>> IT'S YOUR TURN! Use 'place R C N' to place a number.\n");
+                printf("  >>> IT'S YOUR TURN, %s! Use 'place R C N' to place a number.\n", my_name);
             }
             printf("+========================================+\n");
-            print_grid();
-            print_scoreboard();
+            render_board(0);
             break;
             
         case MSG_PLACE_RESULT:
-            if (response->success) {
+            if (response->body.move.success) {
                 printf("\n[+] %s\n", response->text);
             } else {
                 printf("\n[-] %s\n", response->text);
             }
-            print_grid();
-            print_scoreboard();
+            render_board(0);
             break;
             
         case MSG_WAIT:
             // "Wait" can mean "not your turn" OR just a turn notification.
-            printf("\n[WAIT] %s\n", response->text);
+            if (strlen(response->text) > 0) {
+                printf("\n[WAIT] %s\n", response->text);
+            } else if (local_current_turn >= 0 && local_current_turn < MAX_PLAYERS) {
+                printf("\n[WAIT] It's %s's turn (Player %d). Please wait...\n",
+                       local_players[local_current_turn].name, local_current_turn + 1);
+            }
             // Also update the grid to show the latest state if game is in progress
             if (local_cells_remaining > 0) {
-                print_grid();
-                print_scoreboard();
+                render_board(0);
             }
             break;
             
         case MSG_GRID_UPDATE:
             // Another player played -> refresh our view automatically.
-            printf("\n[UPDATE] %s\n", response->text);
-            print_grid();
-            print_scoreboard();
-            if (local_current_turn == player_slot) {
+            {
+                const MoveDelta *move = &response->body.move;
+                const char *who = (move->cell.placed_by < MAX_PLAYERS)
+                                  ? local_players[move->cell.placed_by].name : "?";
+                printf("\n[UPDATE] Player %s %s %d at (%d,%d) - %s\n",
+                       who, move->success ? "placed" : "tried",
+                       move->cell.value, move->cell.row + 1, move->cell.col + 1,
+                       move->success ? "CORRECT!" : "WRONG!");
+            }
+            render_board(0);
+            if (my_seat >= 0 && local_current_turn == my_seat) {
                 printf("\n>>> IT'S YOUR TURN! Use 'place R C N' to place a number.\n");
             }
             break;
             
         case MSG_GAME_STATE:
             printf("\n%s\n", response->text);
-            print_grid();
-            print_scoreboard();
+            render_board(0);
             break;
             
         case MSG_GAME_OVER:
@@ -365,16 +1243,36 @@ void handle_response(GameMessage *response) {
             printf("+========================================+\n");
             printf("  %s\n", response->text);
             printf("+========================================+\n");
-            print_grid();
-            print_scoreboard();
+            render_board(0);
             break;
             
         case MSG_PLAYER_LEFT:
             printf("\n%s\n", response->text);
             break;
             
+        case MSG_LEADERBOARD:
+            print_leaderboard(&response->body.leaders);
+            break;
+            
+        case MSG_STATS:
+            print_stats(&response->body.stats);
+            break;
+            
         case MSG_ERROR:
             printf("\n[ERROR] %s\n", response->text);
+            if (resuming) {
+                resuming = 0;
+                resume_token = 0;
+                my_seat = -1;
+                my_room = -1;
+            }
+            // The only error a spectator gets is a refused watch.
+            if (watching) {
+                watching = 0;
+                my_room = watch_from_room;
+                my_seat = watch_from_seat;
+                if (my_seat >= 0) need_resync = 1;
+            }
             break;
             
         default:
@@ -385,42 +1283,549 @@ void handle_response(GameMessage *response) {
     }
 }
 
+// The server went away while we had a seat it journals: wait for it to
+// come back and ask for the seat again. 0 once the request is sent.
+#define RESUME_TRIES 30
+#define RESUME_RETRY_MS 1000
+
+int reconnect(void) {
+    close(pipe_read_fd);
+    if (pipe_write_fd != pipe_read_fd) close(pipe_write_fd);
+    pipe_read_fd = pipe_write_fd = -1;
+    
+    printf("\n[Client] Lost the connection to the server, waiting to resume...\n");
+    for (int i = 0; i < RESUME_TRIES && client_running; i++) {
+        usleep(RESUME_RETRY_MS * 1000);
+        if (connect_to_server(server_address) < 0) continue;
+        
+        reader.start = reader.end = 0;
+        server_gone = 0;
+        // A restarted server publishes its rooms in a new segment.
+        if (room_view) shmdt((const void *)room_view);
+        room_view = NULL;
+        attach_view();
+        send_resume(resume_token);
+        return 0;
+    }
+    return -1;
+}
+
 // ============================================================================
 // Command Parser
 // ============================================================================
 
-int parse_place_command(const char *input, int *row, int *col, int *value) {
+// "easy", "medium", "hard", "expert" or "any" -> Difficulty.
+int parse_difficulty(const char *text, uint8_t *difficulty) {
+    static const char *names[] = { "any", "easy", "medium", "hard", "expert" };
+    while (*text == ' ') text++;
+    for (int i = 0; i <= DIFF_EXPERT; i++) {
+        if (strcmp(text, names[i]) == 0) {
+            *difficulty = (uint8_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// "place R C N [R C N]..." -> up to max moves as 0-based row, column and
+// the number. Returns how many were given, 0 if it isn't a place command.
+int parse_place_command(const char *input, int (*moves)[3], int max) {
     char cmd[16];
+    int used;
+    
+    if (sscanf(input, "%15s%n", cmd, &used) != 1) return 0;
+    if (strcmp(cmd, "place") != 0 && strcmp(cmd, "p") != 0) return 0;
+    
+    int count = 0;
     int r, c, v;
+    input += used;
+    while (count < max && sscanf(input, "%d %d %d%n", &r, &c, &v, &used) == 3) {
+        moves[count][0] = r - 1;
+        moves[count][1] = c - 1;
+        moves[count][2] = v;
+        count++;
+        input += used;
+    }
+    return count;
+}
+
+// ============================================================================
+// Benchmark
+// ============================================================================
+//
+// ./client --bench ADDRESS forks headless bots that join rooms and play
+// every turn they get, solving the puzzle locally so they can pick right
+// (or, on purpose, wrong) digits. Each bot keeps its counters and latency
+// histograms in a shared mapping, merged by the parent once all are done.
+// Round trip is MSG_PLACE -> our result; broadcast is MSG_PLACE -> another
+// seat's MSG_GRID_UPDATE, timed against the mover's stamp for that seq.
+
+#define HIST_SUB_BITS 3         // same log-linear buckets as the server
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+#define BENCH_MAX_BOTS 256
+#define BENCH_ROOMS 1024        // room ids are folded into this many stamps
+#define BENCH_RETRY_MS 200      // back-off after "all rooms are busy"
+
+typedef struct {
+    uint64_t moves;
+    uint64_t correct;
+    uint64_t wrong;
+    uint64_t games;             // games this bot finished with its move
+    uint64_t errors;
+    uint64_t resyncs;
+    uint32_t rtt[HIST_BUCKETS];
+    uint32_t bcast[HIST_BUCKETS];
+} BotStats;
+
+// When the last move in a room was sent, and the seq it should get.
+typedef struct {
+    uint32_t seq;
+    uint64_t sent_ns;
+} MoveStamp;
+
+typedef struct {
+    MoveStamp stamps[BENCH_ROOMS];
+    BotStats bots[];
+} BenchShared;
+
+typedef struct {
+    const char *address;
+    int bots;
+    double seconds;
+    double rate;                // moves per second per bot, 0 = no limit
+    int wrong_pct;
+    uint8_t difficulty;
+} BenchConfig;
+
+// Per-bot state; every bot is its own process.
+static uint8_t bench_solution[GRID_SIZE * GRID_SIZE];
+static uint16_t bench_banned[GRID_SIZE * GRID_SIZE];  // digits the server refused
+static int bench_solved = 0;
+static int bench_in_flight = 0;
+static uint64_t bench_sent_ns = 0;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int hist_bucket(uint64_t ns) {
+    if (ns < HIST_SUB) return (int)ns;
+    int log = 63 - __builtin_clzll(ns);
+    int sub = (int)(ns >> (log - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return (log - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+// Largest value that falls in bucket b.
+static uint64_t hist_value(int b) {
+    if (b < HIST_SUB) return (uint64_t)b;
+    int log = b / HIST_SUB + HIST_SUB_BITS - 1;
+    uint64_t lower = (uint64_t)(HIST_SUB + b % HIST_SUB) << (log - HIST_SUB_BITS);
+    return lower + ((1ULL << (log - HIST_SUB_BITS)) - 1);
+}
+
+static uint64_t hist_total(const uint32_t *hist) {
+    uint64_t total = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) total += hist[b];
+    return total;
+}
+
+// Upper bound of the bucket holding the given fraction of samples.
+static uint64_t hist_percentile(const uint32_t *hist, uint64_t total, double fraction) {
+    uint64_t want = (uint64_t)(total * fraction + 0.999999), seen = 0;
+    if (want == 0) want = 1;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen >= want) return hist_value(b);
+    }
+    return 0;
+}
+
+// Most constrained cell first; digits the server refused are never retried.
+static int bench_search(uint8_t *g, uint16_t *rows, uint16_t *cols, uint16_t *boxes) {
+    int best = -1, best_count = 10;
+    uint16_t best_free = 0;
+    for (int i = 0; i < GRID_SIZE * GRID_SIZE; i++) {
+        if (g[i] != EMPTY_CELL) continue;
+        int r = i / GRID_SIZE, c = i % GRID_SIZE, b = (r / 3) * 3 + c / 3;
+        uint16_t free = ~(rows[r] | cols[c] | boxes[b] | bench_banned[i]) & 0x1FF;
+        int count = __builtin_popcount(free);
+        if (count < best_count) {
+            best = i;
+            best_count = count;
+            best_free = free;
+            if (count <= 1) break;
+        }
+    }
+    if (best < 0) return 1;
     
-    if (sscanf(input, "%15s %d %d %d", cmd, &r, &c, &v) == 4) {
-        if (strcmp(cmd, "place") == 0 || strcmp(cmd, "p") == 0) {
-            *row = r - 1;
-            *col = c - 1;
-            *value = v;
-            return 1;
+    int r = best / GRID_SIZE, c = best % GRID_SIZE, b = (r / 3) * 3 + c / 3;
+    while (best_free) {
+        uint16_t bit = best_free & (uint16_t)-best_free;
+        best_free &= best_free - 1;
+        g[best] = (uint8_t)(__builtin_ctz(bit) + 1);
+        rows[r] |= bit; cols[c] |= bit; boxes[b] |= bit;
+        if (bench_search(g, rows, cols, boxes)) return 1;
+        rows[r] &= ~bit; cols[c] &= ~bit; boxes[b] &= ~bit;
+    }
+    g[best] = EMPTY_CELL;
+    return 0;
+}
+
+// Re-derive the solution from local_grid, e.g. after a snapshot.
+static void bench_solve(void) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint16_t rows[GRID_SIZE] = {0}, cols[GRID_SIZE] = {0}, boxes[GRID_SIZE] = {0};
+        for (int i = 0; i < GRID_SIZE * GRID_SIZE; i++) {
+            int r = i / GRID_SIZE, c = i % GRID_SIZE;
+            bench_solution[i] = (uint8_t)local_grid[r][c].value;
+            if (bench_solution[i] == EMPTY_CELL) continue;
+            uint16_t bit = (uint16_t)(1u << (bench_solution[i] - 1));
+            rows[r] |= bit; cols[c] |= bit; boxes[(r / 3) * 3 + c / 3] |= bit;
+        }
+        bench_solved = bench_search(bench_solution, rows, cols, boxes);
+        if (bench_solved) return;
+        // A stale ban can make the grid look unsolvable.
+        memset(bench_banned, 0, sizeof(bench_banned));
+    }
+}
+
+static void bench_new_puzzle(void) {
+    memset(bench_banned, 0, sizeof(bench_banned));
+    bench_solve();
+}
+
+// Play the first empty cell after a random start, wrong_pct% of the time
+// with a digit we know the server will refuse.
+static void bench_move(const BenchConfig *cfg, BenchShared *shared) {
+    int start = rand() % (GRID_SIZE * GRID_SIZE), idx = -1;
+    for (int k = 0; k < GRID_SIZE * GRID_SIZE; k++) {
+        int i = (start + k) % (GRID_SIZE * GRID_SIZE);
+        if (local_grid[i / GRID_SIZE][i % GRID_SIZE].value == EMPTY_CELL) {
+            idx = i;
+            break;
+        }
+    }
+    if (idx < 0) return;
+    
+    int value = bench_solution[idx];
+    if (rand() % 100 < cfg->wrong_pct) {
+        value = (value + rand() % (GRID_SIZE - 1)) % GRID_SIZE + 1;
+    }
+    
+    CellDelta place;
+    place.row = (uint8_t)(idx / GRID_SIZE);
+    place.col = (uint8_t)(idx % GRID_SIZE);
+    place.value = (uint8_t)value;
+    place.placed_by = (uint8_t)my_seat;
+    
+    // seq is cleared while the stamp is rewritten so readers skip it.
+    MoveStamp *stamp = &shared->stamps[my_room % BENCH_ROOMS];
+    bench_sent_ns = now_ns();
+    __atomic_store_n(&stamp->seq, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&stamp->sent_ns, bench_sent_ns, __ATOMIC_RELEASE);
+    __atomic_store_n(&stamp->seq, local_seq + 1, __ATOMIC_RELEASE);
+    
+    send_message(MSG_PLACE, &place, sizeof(place));
+    bench_in_flight = 1;
+}
+
+static void bench_broadcast_sample(BotStats *st, BenchShared *shared, uint32_t seq) {
+    MoveStamp *stamp = &shared->stamps[my_room % BENCH_ROOMS];
+    if (__atomic_load_n(&stamp->seq, __ATOMIC_ACQUIRE) != seq) return;
+    uint64_t sent = __atomic_load_n(&stamp->sent_ns, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&stamp->seq, __ATOMIC_ACQUIRE) != seq) return;
+    st->bcast[hist_bucket(now_ns() - sent)]++;
+}
+
+// Returns 1 when the server told us to come back later.
+static int bench_handle(GameMessage *msg, BotStats *st, BenchShared *shared,
+                        const JoinRequest *join) {
+    int mine = bench_in_flight;
+    const MoveDelta *move = &msg->body.move;
+    int idx = move->cell.row * GRID_SIZE + move->cell.col;
+    
+    update_local_state(msg);
+    
+    switch (msg->type) {
+        case MSG_PLAYER_JOINED:
+        case MSG_GAME_START:
+            bench_new_puzzle();
+            break;
+            
+        case MSG_GAME_STATE:
+            bench_solve();
+            break;
+            
+        case MSG_PLACE_RESULT:
+            if (!mine) break;
+            st->rtt[hist_bucket(now_ns() - bench_sent_ns)]++;
+            bench_in_flight = 0;
+            st->moves++;
+            if (move->success) {
+                st->correct++;
+            } else {
+                st->wrong++;
+                // The puzzle has another solution than the one we found.
+                if (move->cell.value == bench_solution[idx]) {
+                    bench_banned[idx] |= (uint16_t)(1u << (move->cell.value - 1));
+                    bench_solve();
+                }
+            }
+            break;
+            
+        case MSG_GRID_UPDATE:
+            bench_broadcast_sample(st, shared, msg->seq);
+            if (move->success && move->cell.value != bench_solution[idx]) bench_solve();
+            break;
+            
+        case MSG_GAME_OVER:
+            if (mine) {
+                st->rtt[hist_bucket(now_ns() - bench_sent_ns)]++;
+                bench_in_flight = 0;
+                st->moves++;
+                st->correct++;
+                st->games++;
+            } else {
+                bench_broadcast_sample(st, shared, msg->seq);
+            }
+            send_message(MSG_JOIN, join, sizeof(*join));
+            break;
+            
+        case MSG_ERROR:
+            bench_in_flight = 0;
+            if (strstr(msg->text, "busy")) return 1;
+            st->errors++;
+            break;
+            
+        default:
+            break;
+    }
+    return 0;
+}
+
+static int bench_bot(const BenchConfig *cfg, int id, BenchShared *shared) {
+    BotStats *st = &shared->bots[id];
+    char address[128];
+    
+    // A FIFO slot number is the first bot's slot.
+    if (strchr(cfg->address, ':') == NULL) {
+        snprintf(address, sizeof(address), "%d", atoi(cfg->address) + id);
+    } else {
+        snprintf(address, sizeof(address), "%s", cfg->address);
+    }
+    if (connect_to_server(address) < 0) {
+        st->errors++;
+        return 1;
+    }
+    
+    srand((unsigned)(getpid() ^ now_ns()));
+    snprintf(my_name, sizeof(my_name), "bot%d", id);
+    memset(local_grid, 0, sizeof(local_grid));
+    memset(local_players, 0, sizeof(local_players));
+    
+    JoinRequest join;
+    memset(&join, 0, sizeof(join));
+    memcpy(join.name, my_name, sizeof(join.name));
+    join.difficulty = cfg->difficulty;
+    send_message(MSG_JOIN, &join, sizeof(join));
+    
+    uint64_t gap_ns = cfg->rate > 0 ? (uint64_t)(1e9 / cfg->rate) : 0;
+    uint64_t deadline = now_ns() + (uint64_t)(cfg->seconds * 1e9);
+    uint64_t next_move = 0, retry_at = 0;
+    GameMessage msg;
+    
+    while (client_running && !server_gone) {
+        uint64_t now = now_ns();
+        if (now >= deadline) break;
+        
+        if (retry_at && now >= retry_at) {
+            retry_at = 0;
+            send_message(MSG_JOIN, &join, sizeof(join));
+        }
+        if (!bench_in_flight && bench_solved && local_game_state == GAME_IN_PROGRESS &&
+            local_current_turn == my_seat && now >= next_move) {
+            bench_move(cfg, shared);
+            next_move = bench_sent_ns + gap_ns;
+        }
+        
+        // Sleep until the next frame, our next allowed move or the deadline.
+        uint64_t wake = deadline;
+        if (retry_at && retry_at < wake) wake = retry_at;
+        if (!bench_in_flight && next_move > now && next_move < wake) wake = next_move;
+        int timeout = frame_pending() ? 0 : (int)((wake - now + 999999) / 1000000);
+        
+        struct pollfd pfd = { .fd = pipe_read_fd, .events = POLLIN, .revents = 0 };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            st->errors++;
+            break;
+        }
+        
+        if (pfd.revents || frame_pending()) {
+            do {
+                if (receive_message(&msg) < 0) {
+                    if (!server_gone) st->errors++;
+                    continue;
+                }
+                if (bench_handle(&msg, st, shared, &join)) {
+                    retry_at = now_ns() + BENCH_RETRY_MS * 1000000ULL;
+                }
+            } while (!server_gone && frame_pending());
+        }
+        
+        if (need_resync) {
+            need_resync = 0;
+            st->resyncs++;
+            send_message(MSG_GAME_STATE, NULL, 0);
         }
     }
     
+    if (server_gone) st->errors++;
+    else send_message(MSG_QUIT, NULL, 0);
+    close(pipe_read_fd);
+    if (pipe_write_fd != pipe_read_fd) close(pipe_write_fd);
     return 0;
 }
 
+static void print_latency(const char *label, const uint32_t *hist) {
+    uint64_t total = hist_total(hist);
+    if (total == 0) {
+        printf("  %-12s %10s %10s %10s %10s %10d\n", label, "-", "-", "-", "-", 0);
+        return;
+    }
+    printf("  %-12s %10.1f %10.1f %10.1f %10.1f %10llu\n", label,
+           hist_percentile(hist, total, 0.50) / 1000.0,
+           hist_percentile(hist, total, 0.99) / 1000.0,
+           hist_percentile(hist, total, 0.999) / 1000.0,
+           hist_percentile(hist, total, 1.0) / 1000.0,
+           (unsigned long long)total);
+}
+
+int run_bench(int argc, char *argv[]) {
+    BenchConfig cfg = { NULL, 30, 10.0, 0.0, 10, DIFF_ANY };
+    
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            cfg.bots = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            cfg.seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            cfg.rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            cfg.wrong_pct = atoi(argv[++i]);
+        } else if (!cfg.address) {
+            cfg.address = argv[i];
+        } else if (parse_difficulty(argv[i], &cfg.difficulty) < 0) {
+            printf("Unknown option or level '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!cfg.address || cfg.bots < 1 || cfg.bots > BENCH_MAX_BOTS || cfg.seconds <= 0 ||
+        cfg.wrong_pct < 0 || cfg.wrong_pct > 100) {
+        printf("Usage: %s --bench <slot | unix:PATH | tcp:HOST:PORT> [-n BOTS] "
+               "[-d SECONDS] [-r MOVES/S] [-w WRONG%%] [LEVEL]\n", argv[0]);
+        printf("       BOTS 1-%d (default 30), SECONDS default 10, "
+               "MOVES/S per bot (default unlimited), WRONG%% default 10\n", BENCH_MAX_BOTS);
+        return 1;
+    }
+    
+    size_t size = sizeof(BenchShared) + (size_t)cfg.bots * sizeof(BotStats);
+    BenchShared *shared = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    
+    struct sigaction sa;
+    sa.sa_handler = sigint_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    printf("[Bench] %d bots against %s for %.1f s\n", cfg.bots, cfg.address, cfg.seconds);
+    fflush(stdout);
+    
+    uint64_t started = now_ns();
+    int launched = 0;
+    for (int i = 0; i < cfg.bots; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            break;
+        }
+        if (pid == 0) {
+            // Bots reuse the interactive client's chatty helpers.
+            int devnull = open("/dev/null", O_WRONLY);
+            if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+            _exit(bench_bot(&cfg, i, shared));
+        }
+        launched++;
+    }
+    
+    int failed = 0, status;
+    while (launched > 0) {
+        if (wait(&status) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        launched--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+    }
+    double elapsed = (now_ns() - started) / 1e9;
+    
+    BotStats sum;
+    memset(&sum, 0, sizeof(sum));
+    for (int i = 0; i < cfg.bots; i++) {
+        const BotStats *b = &shared->bots[i];
+        sum.moves += b->moves;
+        sum.correct += b->correct;
+        sum.wrong += b->wrong;
+        sum.games += b->games;
+        sum.errors += b->errors;
+        sum.resyncs += b->resyncs;
+        for (int k = 0; k < HIST_BUCKETS; k++) {
+            sum.rtt[k] += b->rtt[k];
+            sum.bcast[k] += b->bcast[k];
+        }
+    }
+    
+    printf("\n=== BENCHMARK (%.1f s, %d bots) ===\n", elapsed, cfg.bots);
+    printf("  moves        %llu (%.1f/s), %llu correct, %llu wrong\n",
+           (unsigned long long)sum.moves, sum.moves / elapsed,
+           (unsigned long long)sum.correct, (unsigned long long)sum.wrong);
+    printf("  games        %llu (%.2f/s)\n", (unsigned long long)sum.games, sum.games / elapsed);
+    printf("  errors       %llu, resyncs %llu, bots failed %d\n",
+           (unsigned long long)sum.errors, (unsigned long long)sum.resyncs, failed);
+    printf("\n  %-12s %10s %10s %10s %10s %10s\n", "latency (us)", "p50", "p99", "p999", "max", "samples");
+    print_latency("round trip", sum.rtt);
+    print_latency("broadcast", sum.bcast);
+    printf("====================================\n");
+    
+    munmap(shared, size);
+    return (sum.moves == 0 || failed > 0) ? 1 : 0;
+}
+
 // ============================================================================
 // Main Function
 // ============================================================================
 
 int main(int argc, char *argv[]) {
-    int slot = 0;
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) return run_bench(argc, argv);
     
     if (argc < 3) {
-        printf("Usage: %s <slot 0-%d> <player_name>\n", argv[0], MAX_PLAYERS - 1);
+        printf("Usage: %s <slot 0-%d | unix:PATH | tcp:HOST:PORT> <player_name> "
+               "[easy|medium|hard|expert | --watch ROOM | --resume TOKEN]\n",
+               argv[0], FIFO_SLOTS - 1);
         printf("Example: %s 0 Alice\n", argv[0]);
-        return 1;
-    }
-    
-    slot = atoi(argv[1]);
-    if (slot < 0 || slot >= MAX_PLAYERS) {
-        printf("Invalid slot. Must be 0-%d\n", MAX_PLAYERS - 1);
+        printf("         %s tcp:localhost:7000 Bob\n", argv[0]);
+        printf("  Load test: %s --bench <address> [-n BOTS] [-d SECONDS] [-r MOVES/S] "
+               "[-w WRONG%%] [LEVEL]\n", argv[0]);
         return 1;
     }
     
@@ -432,25 +1837,40 @@ int main(int argc, char *argv[]) {
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = 0;
     sigaction(SIGINT, &sa, NULL);
+    sa.sa_handler = sigwinch_handler;
+    sigaction(SIGWINCH, &sa, NULL);
+    // A server that went away shows up as a failed read, not a signal.
+    signal(SIGPIPE, SIG_IGN);
     
+    // With a board region, draw it first so the rules scroll beneath it.
+    if (render_init()) render_board(1);
     print_game_rules();
     
-    if (connect_to_server(slot) < 0) {
+    server_address = argv[1];
+    if (connect_to_server(server_address) < 0) {
         printf("Make sure the server is running!\n");
         return 1;
     }
     
-    player_slot = slot;
-    
     memset(local_grid, 0, sizeof(local_grid));
     memset(local_players, 0, sizeof(local_players));
+    attach_view();
     
-    GameMessage msg, response;
-    memset(&msg, 0, sizeof(GameMessage));
-    msg.type = MSG_JOIN;
-    msg.player_id = slot;
-    strncpy(msg.player_name, my_name, MAX_NAME_LEN - 1);
-    send_message(&msg);
+    GameMessage response;
+    JoinRequest join;
+    memset(&join, 0, sizeof(join));
+    strncpy(join.name, my_name, MAX_NAME_LEN - 1);
+    if (argc > 4 && strcmp(argv[3], "--watch") == 0) {
+        start_watch(atoi(argv[4]));
+    } else if (argc > 4 && strcmp(argv[3], "--resume") == 0) {
+        resume_token = strtoull(argv[4], NULL, 16);
+        send_resume(resume_token);
+    } else {
+        if (argc > 3 && parse_difficulty(argv[3], &join.difficulty) < 0) {
+            printf("Unknown difficulty '%s', joining any room\n", argv[3]);
+        }
+        send_message(MSG_JOIN, &join, sizeof(join));
+    }
     
     if (receive_message(&response) == 0) {
         handle_response(&response);
@@ -460,41 +1880,66 @@ int main(int argc, char *argv[]) {
     
     char input[64];
     fd_set read_fds;
-    struct timeval timeout;
-    int max_fd = (pipe_read_fd > STDIN_FILENO) ? pipe_read_fd : STDIN_FILENO;
-    max_fd++;
+    struct timeval no_wait = { 0, 0 };
     
     while (client_running) {
         // Use select() so the client can:
         // - read server updates immediately
         // - still accept keyboard input
         // If we only used fgets(), the client would block and NOT auto-update.
+        // Nothing here is periodic, so sleep until one of them (or a signal)
+        // wakes us; only frames already buffered mean "don't wait".
         FD_ZERO(&read_fds);
         FD_SET(STDIN_FILENO, &read_fds);
         FD_SET(pipe_read_fd, &read_fds);
+        int max_fd = ((pipe_read_fd > STDIN_FILENO) ? pipe_read_fd : STDIN_FILENO) + 1;
         
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 100000; // 100ms timeout
-        
-        int ready = select(max_fd, &read_fds, NULL, NULL, &timeout);
+        no_wait.tv_sec = 0;
+        no_wait.tv_usec = 0;
+        int ready = select(max_fd, &read_fds, NULL, NULL, frame_pending() ? &no_wait : NULL);
         
         if (ready < 0) {
-            if (errno == EINTR) continue;
-            perror("select");
+            if (errno != EINTR) {
+                perror("select");
+                break;
+            }
+            if (term_resized) {
+                term_resized = 0;
+                render_reset();
+                if (render_init()) render_board(1);
+            }
+            continue;
+        }
+        
+        // Check for incoming messages from server, then anything else
+        // that came in the same read.
+        if (FD_ISSET(pipe_read_fd, &read_fds) || frame_pending()) {
+            do {
+                if (receive_message(&response) == 0) {
+                    handle_response(&response);
+                }
+            } while (!server_gone && frame_pending());
+        }
+        
+        if (server_gone) {
+            if (resume_token && my_seat >= 0 && reconnect() == 0) continue;
+            printf("\n[Client] Lost the connection to the server\n");
             break;
         }
         
-        // Check for incoming messages from server
-        if (FD_ISSET(pipe_read_fd, &read_fds)) {
-            if (receive_message(&response) == 0) {
-                handle_response(&response);
-            }
+        // A missed delta leaves local_grid stale; pull a full snapshot.
+        // Spectators are resynced by the server unasked.
+        if (need_resync) {
+            need_resync = 0;
+            if (read_view() < 0 && !watching) send_message(MSG_GAME_STATE, NULL, 0);
         }
         
         // Check for user input
         if (FD_ISSET(STDIN_FILENO, &read_fds)) {
             const char *turn_indicator = "";
-            if (local_current_turn == player_slot) {
+            if (watching) {
+                turn_indicator = " [WATCHING]";
+            } else if (my_seat >= 0 && local_current_turn == my_seat) {
                 turn_indicator = " [YOUR TURN]";
             }
             
@@ -511,49 +1956,114 @@ int main(int argc, char *argv[]) {
                 continue;
             }
             
-            memset(&msg, 0, sizeof(GameMessage));
-            msg.player_id = slot;
+            // Anything but quit would end a socket spectator's watch, so
+            // only the local commands are left.
+            if (watching && strcmp(input, "grid") != 0 && strcmp(input, "g") != 0 &&
+                strncmp(input, "hint", 4) != 0 && strcmp(input, "help") != 0 &&
+                strcmp(input, "h") != 0 && strcmp(input, "quit") != 0 && strcmp(input, "q") != 0) {
+                printf("[ERROR] Spectators can only watch (grid, hint, help, quit)\n");
+                continue;
+            }
             
-            int row, col, value;
+            int moves[MAX_BATCH_MOVES][3];
+            int num_moves = parse_place_command(input, moves, MAX_BATCH_MOVES);
             
-            if (parse_place_command(input, &row, &col, &value)) {
-                if (row < 0 || row >= GRID_SIZE || col < 0 || col >= GRID_SIZE) {
-                    printf("[ERROR] Row and column must be 1-9\n");
-                    continue;
+            if (num_moves > 0) {
+                // Several moves go out as one batch; the server plays as
+                // many as the turn allows (see --moves-per-turn).
+                CellDelta place[MAX_BATCH_MOVES];
+                const char *why = NULL;
+                for (int k = 0; k < num_moves && !why; k++) {
+                    int row = moves[k][0];
+                    int col = moves[k][1];
+                    int value = moves[k][2];
+                    if (row < 0 || row >= GRID_SIZE || col < 0 || col >= GRID_SIZE) {
+                        why = "Row and column must be 1-9";
+                    } else if (value < 1 || value > 9) {
+                        why = "Number must be 1-9";
+                    } else {
+                        why = check_place(row, col, value);
+                    }
+                    place[k].row = (uint8_t)row;
+                    place[k].col = (uint8_t)col;
+                    place[k].value = (uint8_t)value;
+                    place[k].placed_by = (uint8_t)my_seat;
                 }
-                if (value < 1 || value > 9) {
-                    printf("[ERROR] Number must be 1-9\n");
+                if (why) {
+                    printf("[ERROR] %s\n", why);
                     continue;
                 }
                 
-                msg.type = MSG_PLACE;
-                msg.row = row;
-                msg.col = col;
-                msg.value = value;
-                send_message(&msg);
+                send_message(MSG_PLACE, place, num_moves * sizeof(CellDelta));
                 
                 if (receive_message(&response) == 0) {
                     handle_response(&response);
                 }
             }
             else if (strcmp(input, "status") == 0 || strcmp(input, "s") == 0) {
-                msg.type = MSG_GAME_STATE;
-                send_message(&msg);
+                send_message(MSG_GAME_STATE, NULL, 0);
                 
                 if (receive_message(&response) == 0) {
                     handle_response(&response);
                 }
             }
             else if (strcmp(input, "grid") == 0 || strcmp(input, "g") == 0) {
-                print_grid();
-                print_scoreboard();
+                render_board(1);
+            }
+            else if (strncmp(input, "join", 4) == 0 || strcmp(input, "j") == 0 ||
+                     strncmp(input, "j ", 2) == 0) {
+                // "join hard" changes the level; plain "join" keeps the last one.
+                const char *arg = strchr(input, ' ');
+                if (arg && parse_difficulty(arg + 1, &join.difficulty) < 0) {
+                    printf("[ERROR] Level must be easy, medium, hard, expert or any\n");
+                    continue;
+                }
+                send_message(MSG_JOIN, &join, sizeof(join));
+            }
+            else if (strncmp(input, "top", 3) == 0 &&
+                     (input[3] == '\0' || input[3] == ' ')) {
+                // "top" ranks by wins, "top accuracy" by correct placements.
+                uint8_t board = BOARD_WINS;
+                const char *arg = input + 3;
+                while (*arg == ' ') arg++;
+                if (strcmp(arg, "accuracy") == 0 || strcmp(arg, "a") == 0) {
+                    board = BOARD_ACCURACY;
+                } else if (*arg != '\0' && strcmp(arg, "wins") != 0) {
+                    printf("[ERROR] Board must be wins or accuracy\n");
+                    continue;
+                }
+                send_message(MSG_LEADERBOARD, &board, sizeof(board));
+            }
+            else if (strncmp(input, "hint", 4) == 0 &&
+                     (input[4] == '\0' || input[4] == ' ')) {
+                int r = 0, c = 0;
+                int args = sscanf(input + 4, "%d %d", &r, &c);
+                if (args == 2 && (r < 1 || r > GRID_SIZE || c < 1 || c > GRID_SIZE)) {
+                    printf("[ERROR] Row and column must be 1-9\n");
+                } else if (args == 2) {
+                    print_hint(r - 1, c - 1);
+                } else if (args <= 0) {
+                    print_hint(-1, -1);
+                } else {
+                    printf("[ERROR] Use 'hint' or 'hint R C'\n");
+                }
+            }
+            else if (strcmp(input, "stats") == 0) {
+                send_message(MSG_STATS, NULL, 0);
+            }
+            else if (strncmp(input, "watch ", 6) == 0) {
+                int room = -1;
+                if (sscanf(input + 6, "%d", &room) != 1 || room < 0) {
+                    printf("[ERROR] Use 'watch ROOM'\n");
+                    continue;
+                }
+                start_watch(room);
             }
             else if (strcmp(input, "help") == 0 || strcmp(input, "h") == 0) {
                 print_help();
             }
             else if (strcmp(input, "quit") == 0 || strcmp(input, "q") == 0) {
-                msg.type = MSG_QUIT;
-                send_message(&msg);
+                send_message(MSG_QUIT, NULL, 0);
                 
                 if (receive_message(&response) == 0) {
                     handle_response(&response);
@@ -567,8 +2077,9 @@ int main(int argc, char *argv[]) {
     }
     
     close(pipe_read_fd);
-    close(pipe_write_fd);
+    if (pipe_write_fd != pipe_read_fd) close(pipe_write_fd);
     
+    render_reset();
     printf("[Client] Goodbye!\n");
     return 0;
 }